@@ -21,6 +21,7 @@
 #define ZMK_BTHOME_OBJECT_ID_CONNECTIVITY 0x19
 #define ZMK_BTHOME_OBJECT_ID_BUTTON 0x3A
 #define ZMK_BTHOME_OBJECT_ID_DIMMER 0x3C
+#define ZMK_BTHOME_OBJECT_ID_COUNT_UINT16 0x3D
 
 #define ZMK_BTHOME_SERVICE_UUID 0xfcd2
 #define ZMK_BTHOME_SERVICE_UUID_1 0xd2
@@ -35,12 +36,44 @@
 #endif
 
 #define BTHOME_ENCRYPT_TAG_LEN 4
+// Most object bytes an encrypted payload can carry: 26 bytes of service
+// data minus uuid(2) + device_info(1) + counter(4) + MIC
+#define BTHOME_ENCRYPT_MAX_DATA_LEN (26 - 3 - 4 - BTHOME_ENCRYPT_TAG_LEN)
 
 #if IS_ENABLED(CONFIG_ZMK_BTHOME_ENCRYPTION_ENABLED)
 void zmk_bthome_encrypt_init(const uint8_t ble_addr[6]);
-int zmk_bthome_encrypt_payload(const uint8_t *plaintext, const size_t plaintext_len,
-                               const uint32_t replay_counter, uint8_t *enc_out,
+// Encrypts `data` in place
+int zmk_bthome_encrypt_payload(uint8_t *data, const size_t data_len,
+                               const uint32_t replay_counter,
                                uint8_t mic_out[BTHOME_ENCRYPT_TAG_LEN]);
 #endif
 
+#if IS_ENABLED(CONFIG_ZMK_BTHOME_CRYPTO_BUILTIN)
+// AES-128-CCM with 13-byte nonce, 4-byte tag and no AAD, encrypts `data` in place
+int zmk_bthome_aes_ccm_encrypt(const uint8_t key[16], const uint8_t nonce[13],
+                               uint8_t *data, const size_t data_len,
+                               uint8_t tag_out[BTHOME_ENCRYPT_TAG_LEN]);
+#endif
+
+#if IS_ENABLED(CONFIG_ZMK_BTHOME_COEX)
+#if IS_ENABLED(CONFIG_ZMK_BTHOME_COEX_ALIGN_CONN_INTERVAL)
+// Advertising interval (0.625ms units) to use for the next burst
+void zmk_bthome_coex_adv_interval(uint32_t *interval_min, uint32_t *interval_max);
+#endif
+#if CONFIG_ZMK_BTHOME_COEX_TYPING_HOLDOFF_MS > 0
+// Milliseconds to hold back a battery-only update, 0 to send now
+int32_t zmk_bthome_coex_typing_holdoff_ms(void);
+#endif
+// Called after an advertisement started with the given interval range (0.625ms units)
+void zmk_bthome_coex_adv_started(uint32_t interval_min, uint32_t interval_max);
+#if IS_ENABLED(CONFIG_ZMK_BTHOME_COEX_STATS)
+void zmk_bthome_coex_burst_sent(uint8_t num_sent);
+#endif
+#if CONFIG_ZMK_BTHOME_COEX_TYPING_HOLDOFF_MS > 0 || IS_ENABLED(CONFIG_ZMK_BTHOME_COEX_STATS)
+#define ZMK_BTHOME_COEX_TRACK_TYPING 1
+// Called for every key press
+void zmk_bthome_coex_key_pressed(void);
+#endif
+#endif
+
 int zmk_bthome_queue_button_event(uint8_t index, uint8_t button_code);
@@ -18,25 +18,36 @@
 #include <zephyr/sys/byteorder.h>
 #include <zephyr/sys/util.h>
 
+// before the conditional event includes, it defines ZMK_BTHOME_COEX_TRACK_TYPING
+#include <zmk_bthome/zmk_bthome.h>
+#include <dt-bindings/zmk_bthome/button.h>
+
 #include <zmk/battery.h>
 #include <zmk/event_manager.h>
 #include <zmk/events/battery_state_changed.h>
-
-#include <zmk_bthome/zmk_bthome.h>
-#include <dt-bindings/zmk_bthome/button.h>
+#if IS_ENABLED(CONFIG_ZMK_BTHOME_KEY_COUNT) || defined(ZMK_BTHOME_COEX_TRACK_TYPING)
+#include <zmk/events/position_state_changed.h>
+#endif
+#if IS_ENABLED(CONFIG_ZMK_BTHOME_KEY_COUNT)
+#include <zmk/keymap.h>
+#endif
+#if IS_ENABLED(CONFIG_ZMK_BTHOME_SLEEP_FLUSH)
+#include <zmk/activity.h>
+#include <zmk/events/activity_state_changed.h>
+#endif
 
 #include <zephyr/logging/log.h>
 LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 
 struct zmk_bthome_obj8
 {
-    const uint8_t obj_id;
+    uint8_t obj_id;
     uint8_t data;
 } __packed;
 
 struct zmk_bthome_obj16
 {
-    const uint8_t obj_id;
+    uint8_t obj_id;
     uint16_t data;
 } __packed;
 
@@ -47,14 +58,16 @@ struct zmk_bthome_obj16
 #define BTHOME_BUTTON_NUM 0
 #endif
 
-// uuid(2) + device_info(1)
-#define PAYLOAD_CONTENT_OFFSET 3
-#define PAYLOAD_CONTENT_SIZE (sizeof(struct zmk_bthome_payload) - PAYLOAD_CONTENT_OFFSET)
+// Number of layers with their own key count
+#if IS_ENABLED(CONFIG_ZMK_BTHOME_KEY_COUNT) && defined(CONFIG_ZMK_BTHOME_KEY_COUNT_LAYERS)
+#define BTHOME_KEY_COUNT_LAYERS CONFIG_ZMK_BTHOME_KEY_COUNT_LAYERS
+#else
+#define BTHOME_KEY_COUNT_LAYERS 0
+#endif
 
-struct zmk_bthome_payload
+// BTHome objects, encrypted in place when encryption is enabled
+struct zmk_bthome_objects
 {
-    const uint8_t uuid[2];
-    const uint8_t device_info;
 #if IS_ENABLED(CONFIG_ZMK_BTHOME_PACKET_ID)
     struct zmk_bthome_obj8 packet_id;
 #endif
@@ -67,69 +80,132 @@ struct zmk_bthome_payload
 #if (BTHOME_BUTTON_NUM > 0)
     struct zmk_bthome_obj8 buttons[BTHOME_BUTTON_NUM];
 #endif
-} __packed;
-
-static union
-{
-    struct zmk_bthome_payload data;
-    uint8_t bytes[sizeof(struct zmk_bthome_payload)];
-} bthome_payload = {
-    .data = {
-        .uuid = {BT_UUID_16_ENCODE(ZMK_BTHOME_SERVICE_UUID)},
-        .device_info = ZMK_BTHOME_DEVICE_INFO,
-#if IS_ENABLED(CONFIG_ZMK_BTHOME_PACKET_ID)
-        .packet_id = {.obj_id = ZMK_BTHOME_OBJECT_ID_PACKET_ID, .data = 0},
+#if IS_ENABLED(CONFIG_ZMK_BTHOME_KEY_COUNT)
+    struct zmk_bthome_obj16 key_count;
 #endif
-
-#if IS_ENABLED(CONFIG_ZMK_BTHOME_BATTERY_LEVEL)
-        .battery_level = {.obj_id = ZMK_BTHOME_OBJECT_ID_BATTERY, .data = 0},
+#if (BTHOME_KEY_COUNT_LAYERS > 0)
+    struct zmk_bthome_obj16 layer_key_counts[BTHOME_KEY_COUNT_LAYERS];
 #endif
-#if IS_ENABLED(CONFIG_ZMK_BTHOME_BATTERY_VOLTAGE)
-        .battery_voltage = {.obj_id = ZMK_BTHOME_OBJECT_ID_VOLTAGE_THOUSANDTH, .data = 0},
-#endif
-
-#if (BTHOME_BUTTON_NUM > 0)
-        .buttons = {[0 ...(BTHOME_BUTTON_NUM - 1)] = {.obj_id = ZMK_BTHOME_OBJECT_ID_BUTTON, .data = BTHOME_BTN_NONE}},
-#endif
-    },
-};
+} __packed;
 
 #if IS_ENABLED(CONFIG_ZMK_BTHOME_ENCRYPTION_ENABLED)
+// also sizes the stack copy used by crypto drivers without in-place support
+BUILD_ASSERT(sizeof(struct zmk_bthome_objects) <= BTHOME_ENCRYPT_MAX_DATA_LEN,
+             "ZMK BTHome objects exceed the maximum encrypted payload size.");
+#endif
 
-struct zmk_bthome_encrypted_payload
+struct zmk_bthome_payload
 {
     const uint8_t uuid[2];
     const uint8_t device_info;
-    uint8_t encrypted_data[PAYLOAD_CONTENT_SIZE];
+    struct zmk_bthome_objects objects;
+#if IS_ENABLED(CONFIG_ZMK_BTHOME_ENCRYPTION_ENABLED)
     // little endian counter
     uint32_t counter;
     // Message Integrity Check (4 bytes)
     uint8_t mic[BTHOME_ENCRYPT_TAG_LEN];
+#endif
 } __packed;
 
 static union
 {
-    struct zmk_bthome_encrypted_payload data;
-    uint8_t bytes[sizeof(struct zmk_bthome_encrypted_payload)];
-} bthome_encrypted_payload = {
+    struct zmk_bthome_payload data;
+    uint8_t bytes[sizeof(struct zmk_bthome_payload)];
+} bthome_payload = {
     .data = {
         .uuid = {BT_UUID_16_ENCODE(ZMK_BTHOME_SERVICE_UUID)},
         .device_info = ZMK_BTHOME_DEVICE_INFO,
+        .objects = {
+#if IS_ENABLED(CONFIG_ZMK_BTHOME_PACKET_ID)
+            .packet_id = {.obj_id = ZMK_BTHOME_OBJECT_ID_PACKET_ID, .data = 0},
+#endif
+#if IS_ENABLED(CONFIG_ZMK_BTHOME_BATTERY_LEVEL)
+            .battery_level = {.obj_id = ZMK_BTHOME_OBJECT_ID_BATTERY, .data = 0},
+#endif
+#if IS_ENABLED(CONFIG_ZMK_BTHOME_BATTERY_VOLTAGE)
+            .battery_voltage = {.obj_id = ZMK_BTHOME_OBJECT_ID_VOLTAGE_THOUSANDTH, .data = 0},
+#endif
+#if (BTHOME_BUTTON_NUM > 0)
+            .buttons = {[0 ...(BTHOME_BUTTON_NUM - 1)] = {.obj_id = ZMK_BTHOME_OBJECT_ID_BUTTON, .data = BTHOME_BTN_NONE}},
+#endif
+#if IS_ENABLED(CONFIG_ZMK_BTHOME_KEY_COUNT)
+            .key_count = {.obj_id = ZMK_BTHOME_OBJECT_ID_COUNT_UINT16, .data = 0},
+#endif
+#if (BTHOME_KEY_COUNT_LAYERS > 0)
+            .layer_key_counts = {[0 ...(BTHOME_KEY_COUNT_LAYERS - 1)] = {.obj_id = ZMK_BTHOME_OBJECT_ID_COUNT_UINT16, .data = 0}},
+#endif
+        },
 
+#if IS_ENABLED(CONFIG_ZMK_BTHOME_ENCRYPTION_ENABLED)
         // Parser used in Home Assistant assumes after a device restart the
         // encryption counter starts at 0 again, and will accept any value
         // less than 100 OR greater than the last seen counter.
         .counter = 0,
+#endif
     },
 };
 
-#endif // IS_ENABLED(CONFIG_ZMK_BTHOME_ENCRYPTION_ENABLED)
-
 #if IS_ENABLED(CONFIG_ZMK_BTHOME_ENCRYPTION_ENABLED)
-#define ACTIVE_BTHOME_PAYLOAD bthome_encrypted_payload
-#else
-#define ACTIVE_BTHOME_PAYLOAD bthome_payload
+
+// Every send overwrites the objects in the payload with ciphertext, so
+// with encryption the sensor values are kept here (16-bit values little
+// endian) and written back into the payload before encrypting.
+#if IS_ENABLED(CONFIG_ZMK_BTHOME_PACKET_ID)
+static uint8_t bthome_packet_id;
+#endif
+#if IS_ENABLED(CONFIG_ZMK_BTHOME_BATTERY_LEVEL)
+static uint8_t bthome_battery_level;
+#endif
+#if IS_ENABLED(CONFIG_ZMK_BTHOME_BATTERY_VOLTAGE)
+static uint16_t bthome_battery_voltage;
+#endif
+#if IS_ENABLED(CONFIG_ZMK_BTHOME_KEY_COUNT)
+static uint16_t bthome_key_count;
+#endif
+#if (BTHOME_KEY_COUNT_LAYERS > 0)
+static uint16_t bthome_layer_key_counts[BTHOME_KEY_COUNT_LAYERS];
+#endif
+
+#define BTHOME_VALUE(name) bthome_##name
+#define BTHOME_LAYER_KEY_COUNT(layer) bthome_layer_key_counts[layer]
+
+// Write the plaintext sensor objects back into the payload, buttons excluded
+static void bthome_payload_fill_objects(void)
+{
+    struct zmk_bthome_objects *objects = &bthome_payload.data.objects;
+
+#if IS_ENABLED(CONFIG_ZMK_BTHOME_PACKET_ID)
+    objects->packet_id.obj_id = ZMK_BTHOME_OBJECT_ID_PACKET_ID;
+    objects->packet_id.data = bthome_packet_id;
+#endif
+#if IS_ENABLED(CONFIG_ZMK_BTHOME_BATTERY_LEVEL)
+    objects->battery_level.obj_id = ZMK_BTHOME_OBJECT_ID_BATTERY;
+    objects->battery_level.data = bthome_battery_level;
+#endif
+#if IS_ENABLED(CONFIG_ZMK_BTHOME_BATTERY_VOLTAGE)
+    objects->battery_voltage.obj_id = ZMK_BTHOME_OBJECT_ID_VOLTAGE_THOUSANDTH;
+    objects->battery_voltage.data = bthome_battery_voltage;
+#endif
+#if IS_ENABLED(CONFIG_ZMK_BTHOME_KEY_COUNT)
+    objects->key_count.obj_id = ZMK_BTHOME_OBJECT_ID_COUNT_UINT16;
+    objects->key_count.data = bthome_key_count;
+#endif
+#if (BTHOME_KEY_COUNT_LAYERS > 0)
+    for (int i = 0; i < BTHOME_KEY_COUNT_LAYERS; i++)
+    {
+        objects->layer_key_counts[i].obj_id = ZMK_BTHOME_OBJECT_ID_COUNT_UINT16;
+        objects->layer_key_counts[i].data = bthome_layer_key_counts[i];
+    }
 #endif
+}
+
+#else
+
+// Without encryption the payload itself holds the sensor values
+#define BTHOME_VALUE(name) bthome_payload.data.objects.name.data
+#define BTHOME_LAYER_KEY_COUNT(layer) bthome_payload.data.objects.layer_key_counts[layer].data
+
+#endif // IS_ENABLED(CONFIG_ZMK_BTHOME_ENCRYPTION_ENABLED)
 
 static const struct bt_data zmk_bthome_ad[] = {
     BT_DATA_BYTES(BT_DATA_FLAGS, BT_LE_AD_GENERAL | BT_LE_AD_NO_BREDR),
@@ -139,7 +215,7 @@ static const struct bt_data zmk_bthome_ad[] = {
             sizeof(CONFIG_ZMK_BTHOME_DEVICE_NAME) - 1),
 #endif
 
-    BT_DATA(BT_DATA_SVC_DATA16, ACTIVE_BTHOME_PAYLOAD.bytes, sizeof(ACTIVE_BTHOME_PAYLOAD)),
+    BT_DATA(BT_DATA_SVC_DATA16, bthome_payload.bytes, sizeof(bthome_payload)),
 };
 
 //   sizeof(name) - 1 (for null) + 2 (for header)
@@ -161,7 +237,7 @@ static const struct bt_data zmk_bthome_ad[] = {
 // rest of the payload
 // encryption overhead (if enabled)
 
-BUILD_ASSERT((NAME_LENGTH + sizeof(ACTIVE_BTHOME_PAYLOAD)) <= 26,
+BUILD_ASSERT((NAME_LENGTH + sizeof(bthome_payload)) <= 26,
              "ZMK BTHome advertisement payload exceeds maximum advertisement size. "
              "You can reduce the size by shortening or removing the device name, "
              "reducing the number of buttons configured, disabling battery reporting, "
@@ -182,58 +258,197 @@ static void zmkbthome_adv_sent(struct bt_le_ext_adv *adv, struct bt_le_ext_adv_s
 static struct bt_le_ext_adv *bthome_adv;
 static bool bthome_adv_active;
 
+#if IS_ENABLED(CONFIG_ZMK_BTHOME_SLEEP_FLUSH)
+// given when an advertisement finishes, waited on before going to sleep
+static K_SEM_DEFINE(bthome_adv_done_sem, 0, 1);
+#endif
+
 static const struct bt_le_ext_adv_cb bthome_adv_cb = {
     .sent = zmkbthome_adv_sent,
 };
 
-static void zmkbthome_button_queue_work_handler(struct k_work *work)
+#if IS_ENABLED(CONFIG_ZMK_BTHOME_COEX_ALIGN_CONN_INTERVAL)
+// interval is updated before every burst
+static struct bt_le_adv_param bthome_adv_param =
+    BT_LE_ADV_PARAM_INIT(BT_LE_ADV_OPT_USE_IDENTITY,
+                         BT_GAP_ADV_FAST_INT_MIN_2,
+                         BT_GAP_ADV_FAST_INT_MAX_2,
+                         NULL);
+#define BTHOME_ADV_PARAM (&bthome_adv_param)
+#else
+#define BTHOME_ADV_PARAM BT_LE_ADV_NCONN_IDENTITY
+#endif
+
+#if CONFIG_ZMK_BTHOME_COEX_TYPING_HOLDOFF_MS > 0
+static void zmkbthome_holdoff_work_handler(struct k_work *work)
 {
     ARG_UNUSED(work);
+    k_work_submit(&zmkhome_button_queue);
+}
+K_WORK_DELAYABLE_DEFINE(zmkbthome_holdoff_work, zmkbthome_holdoff_work_handler);
+
+// True if every queued event is a battery-only placeholder
+static bool bthome_queue_battery_only(void)
+{
+    struct zmk_bthome_button_event evt;
+    for (uint32_t i = 0; k_msgq_peek_at(&zmkbthome_button_msgq, &evt, i) == 0; i++)
+    {
+        if (evt.code != BTHOME_BTN_NONE)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+#endif
+
+static int zmkbthome_adv_setup(void)
+{
+    int rc_create = bt_le_ext_adv_create(BTHOME_ADV_PARAM, &bthome_adv_cb, &bthome_adv);
+    if (rc_create != 0 || bthome_adv == NULL)
+    {
+        LOG_ERR("Failed to create BTHome advertiser: %d", rc_create);
+        bthome_adv = NULL;
+        return rc_create != 0 ? rc_create : -ENOMEM;
+    }
+
+    LOG_INF("BTHome advertiser created");
+
+#if IS_ENABLED(CONFIG_ZMK_BTHOME_ENCRYPTION_ENABLED)
+    {
+        bt_addr_le_t id_addr;
+        size_t count = 1;
+        bt_id_get(&id_addr, &count);
+        if (count > 0)
+        {
+            zmk_bthome_encrypt_init(id_addr.a.val);
+            LOG_INF("BTHome encryption initialized with BT ID address");
+        }
+        else
+        {
+            LOG_ERR("No BT ID address available for BTHome encryption");
+        }
+    }
+#endif
+
+    return 0;
+}
+
+// Not creating in SYS_INIT callback because bt_id is loaded after that
+// and bt is not ready yet at that time. bt_le_ext_adv_create will return -EAGAIN.
+// Poll until it is, so the advertiser exists before the first event.
+#define BTHOME_ADV_SETUP_RETRY_MS 50
+
+static void zmkbthome_adv_setup_work_handler(struct k_work *work);
+K_WORK_DELAYABLE_DEFINE(zmkbthome_adv_setup_work, zmkbthome_adv_setup_work_handler);
+
+static void zmkbthome_adv_setup_work_handler(struct k_work *work)
+{
+    ARG_UNUSED(work);
+
+    if (!bt_is_ready())
+    {
+        k_work_reschedule(&zmkbthome_adv_setup_work, K_MSEC(BTHOME_ADV_SETUP_RETRY_MS));
+        return;
+    }
+
+    if (bthome_adv == NULL && zmkbthome_adv_setup() != 0)
+    {
+        return;
+    }
+
+    // Send anything that was queued before Bluetooth became ready
+    k_work_submit(&zmkhome_button_queue);
+}
+
+#if IS_ENABLED(CONFIG_ZMK_BTHOME_KEY_COUNT)
+static bool bthome_key_count_report(void);
+static void bthome_key_count_work_handler(struct k_work *work);
+K_WORK_DELAYABLE_DEFINE(bthome_key_count_work, bthome_key_count_work_handler);
+#endif
+
+static int zmkbthome_init(void)
+{
+    k_work_schedule(&zmkbthome_adv_setup_work, K_NO_WAIT);
+#if IS_ENABLED(CONFIG_ZMK_BTHOME_KEY_COUNT)
+    k_work_schedule(&bthome_key_count_work, K_SECONDS(CONFIG_ZMK_BTHOME_KEY_COUNT_INTERVAL));
+#endif
+    return 0;
+}
+SYS_INIT(zmkbthome_init, APPLICATION, CONFIG_APPLICATION_INIT_PRIORITY);
+
+// Start advertising whatever data is currently set on the advertiser
+static int zmkbthome_adv_start(const uint8_t num_events)
+{
+    int rc = bt_le_ext_adv_start(bthome_adv, BT_LE_EXT_ADV_START_PARAM(CONFIG_ZMK_BTHOME_ADV_TIMEOUT, num_events));
+    if (rc != 0)
+    {
+        LOG_ERR("Failed to start BTHome advertisement: %d", rc);
+        return rc;
+    }
+
+    LOG_INF("BTHome advertisement started");
+    bthome_adv_active = true;
+#if IS_ENABLED(CONFIG_ZMK_BTHOME_COEX)
+    zmk_bthome_coex_adv_started(BTHOME_ADV_PARAM->interval_min, BTHOME_ADV_PARAM->interval_max);
+#endif
+    return 0;
+}
 
+// Send everything queued in one advertisement. `flush` sends a short final
+// burst right away, used before the keyboard goes to sleep.
+static void zmkbthome_send_queued(const bool flush)
+{
     if (bthome_adv_active)
     {
         return;
     }
 
-    // Not creating in SYS_INIT callback because bt_id is loaded after that
-    // and bt is not ready yet at that time. bt_le_ext_adv_create will return -EAGAIN.
     if (bthome_adv == NULL)
     {
         if (!bt_is_ready())
         {
-            LOG_WRN("Bluetooth not ready; deferring BTHome adv setup");
-            // message is intentionally dropped, so we don't send a burst of ads later
+            // Events stay queued until the advertiser setup work runs
+            LOG_DBG("Bluetooth not ready; holding BTHome events");
             return;
         }
 
-        int rc_create = bt_le_ext_adv_create(BT_LE_ADV_NCONN_IDENTITY, &bthome_adv_cb, &bthome_adv);
-        if (rc_create != 0 || bthome_adv == NULL)
+        // Setup failed earlier, try again now
+        if (zmkbthome_adv_setup() != 0)
         {
-            LOG_ERR("Failed to create BTHome advertiser in work: %d", rc_create);
             return;
         }
+    }
 
-        LOG_INF("BTHome advertiser created in work");
+#if IS_ENABLED(CONFIG_ZMK_BTHOME_SLEEP_FLUSH)
+    const uint8_t num_events = flush ? CONFIG_ZMK_BTHOME_SLEEP_FLUSH_PACKETS : CONFIG_ZMK_BTHOME_ADV_PACKETS;
+#else
+    ARG_UNUSED(flush);
+    const uint8_t num_events = CONFIG_ZMK_BTHOME_ADV_PACKETS;
+#endif
 
-#if IS_ENABLED(CONFIG_ZMK_BTHOME_ENCRYPTION_ENABLED)
+#if CONFIG_ZMK_BTHOME_COEX_TYPING_HOLDOFF_MS > 0
+    if (!flush && k_msgq_num_used_get(&zmkbthome_button_msgq) > 0 && bthome_queue_battery_only())
+    {
+        int32_t holdoff = zmk_bthome_coex_typing_holdoff_ms();
+        if (holdoff > 0)
         {
-            static bt_addr_le_t id_addrs[CONFIG_BT_ID_MAX];
-            size_t count = 1;
-            bt_id_get(id_addrs, &count);
-            if (count > 0)
-            {
-                uint8_t addr[6];
-                memcpy(addr, id_addrs[BT_ID_DEFAULT].a.val, 6);
-                zmk_bthome_encrypt_init(addr);
-                LOG_INF("BTHome encryption initialized with BT ID address");
-            }
-            else
-            {
-                LOG_ERR("No BT ID address available for BTHome encryption");
-            }
+            LOG_DBG("Holding back battery-only BTHome update for %d ms", holdoff);
+            k_work_reschedule(&zmkbthome_holdoff_work, K_MSEC(holdoff));
+            return;
         }
+    }
 #endif
+
+    /* Start with all buttons cleared, then read queued events and apply
+     * each to the advertisement payload so the last write wins. */
+#if (BTHOME_BUTTON_NUM > 0)
+    for (int i = 0; i < BTHOME_BUTTON_NUM; i++)
+    {
+        bthome_payload.data.objects.buttons[i].obj_id = ZMK_BTHOME_OBJECT_ID_BUTTON;
+        bthome_payload.data.objects.buttons[i].data = BTHOME_BTN_NONE;
     }
+#endif
 
 #if BTHOME_BUTTON_NUM == 0
     {
@@ -257,13 +472,6 @@ static void zmkbthome_button_queue_work_handler(struct k_work *work)
         LOG_DBG("No BTHome buttons configured, sending everything else");
     }
 #else
-    /* Start with all buttons cleared, then read queued events and apply
-     * each to the advertisement payload so the last write wins. */
-    for (int i = 0; i < BTHOME_BUTTON_NUM; i++)
-    {
-        bthome_payload.data.buttons[i].data = BTHOME_BTN_NONE;
-    }
-
     {
         bool got_event = false;
         struct zmk_bthome_button_event evt;
@@ -283,7 +491,7 @@ static void zmkbthome_button_queue_work_handler(struct k_work *work)
                 continue;
             }
 
-            bthome_payload.data.buttons[evt.index].data = evt.code;
+            bthome_payload.data.objects.buttons[evt.index].data = evt.code;
         }
 
         if (!got_event)
@@ -296,18 +504,21 @@ static void zmkbthome_button_queue_work_handler(struct k_work *work)
 #endif
 
 #if IS_ENABLED(CONFIG_ZMK_BTHOME_PACKET_ID)
-    bthome_payload.data.packet_id.data++;
+    BTHOME_VALUE(packet_id)++;
 #endif
 
 #if IS_ENABLED(CONFIG_ZMK_BTHOME_ENCRYPTION_ENABLED)
-    bthome_encrypted_payload.data.counter =
-        sys_cpu_to_le32(sys_le32_to_cpu(bthome_encrypted_payload.data.counter) + 1);
+    // The previous send left ciphertext in the payload
+    bthome_payload_fill_objects();
+
+    bthome_payload.data.counter =
+        sys_cpu_to_le32(sys_le32_to_cpu(bthome_payload.data.counter) + 1);
 
+    // Objects are replaced by their ciphertext, the MIC follows the counter
     int enc_rc = zmk_bthome_encrypt_payload(
-        (bthome_payload.bytes + PAYLOAD_CONTENT_OFFSET), PAYLOAD_CONTENT_SIZE,
-        bthome_encrypted_payload.data.counter,
-        bthome_encrypted_payload.data.encrypted_data,
-        bthome_encrypted_payload.data.mic);
+        (uint8_t *)&bthome_payload.data.objects, sizeof(bthome_payload.data.objects),
+        bthome_payload.data.counter,
+        bthome_payload.data.mic);
     if (enc_rc != 0)
     {
         LOG_ERR("BTHome payload encryption failed: %d", enc_rc);
@@ -315,6 +526,25 @@ static void zmkbthome_button_queue_work_handler(struct k_work *work)
     }
 #endif
 
+#if IS_ENABLED(CONFIG_ZMK_BTHOME_COEX_ALIGN_CONN_INTERVAL)
+    {
+        uint32_t interval_min, interval_max;
+        zmk_bthome_coex_adv_interval(&interval_min, &interval_max);
+        if (interval_min != bthome_adv_param.interval_min || interval_max != bthome_adv_param.interval_max)
+        {
+            bthome_adv_param.interval_min = interval_min;
+            bthome_adv_param.interval_max = interval_max;
+
+            // advertiser is stopped here, so parameters can be changed
+            int rc_param = bt_le_ext_adv_update_param(bthome_adv, &bthome_adv_param);
+            if (rc_param != 0)
+            {
+                LOG_WRN("Failed to update BTHome advertising interval: %d", rc_param);
+            }
+        }
+    }
+#endif
+
     int rc = bt_le_ext_adv_set_data(bthome_adv, zmk_bthome_ad, ARRAY_SIZE(zmk_bthome_ad), NULL, 0);
     if (rc != 0)
     {
@@ -322,16 +552,14 @@ static void zmkbthome_button_queue_work_handler(struct k_work *work)
         return;
     }
 
-    rc = bt_le_ext_adv_start(bthome_adv, BT_LE_EXT_ADV_START_PARAM(CONFIG_ZMK_BTHOME_ADV_TIMEOUT, CONFIG_ZMK_BTHOME_ADV_PACKETS));
-    if (rc == 0)
-    {
-        LOG_INF("BTHome advertisement started");
-        bthome_adv_active = true;
-    }
-    else
-    {
-        LOG_ERR("Failed to start BTHome advertisement: %d", rc);
-    }
+    zmkbthome_adv_start(num_events);
+}
+
+static void zmkbthome_button_queue_work_handler(struct k_work *work)
+{
+    ARG_UNUSED(work);
+
+    zmkbthome_send_queued(false);
 }
 
 static inline bool bthome_button_code_valid(const uint8_t button_code)
@@ -398,12 +626,91 @@ int zmk_bthome_queue_button_event(uint8_t index, uint8_t button_code)
 static void zmkbthome_adv_sent(struct bt_le_ext_adv *adv, struct bt_le_ext_adv_sent_info *info)
 {
     ARG_UNUSED(adv);
+
+#if IS_ENABLED(CONFIG_ZMK_BTHOME_COEX_STATS)
+    zmk_bthome_coex_burst_sent(info->num_sent);
+#else
     ARG_UNUSED(info);
+#endif
 
     bthome_adv_active = false;
+#if IS_ENABLED(CONFIG_ZMK_BTHOME_SLEEP_FLUSH)
+    k_sem_give(&bthome_adv_done_sem);
+#endif
     k_work_submit(&zmkhome_button_queue);
 }
 
+#if IS_ENABLED(CONFIG_ZMK_BTHOME_SLEEP_FLUSH)
+
+static void bthome_wait_adv_done(const int64_t deadline)
+{
+    while (bthome_adv_active)
+    {
+        int64_t remaining = deadline - k_uptime_get();
+        if (remaining <= 0 || k_sem_take(&bthome_adv_done_sem, K_MSEC(remaining)) != 0)
+        {
+            LOG_WRN("BTHome final advertisement did not finish before sleep");
+            return;
+        }
+    }
+}
+
+// ZMK powers off right after raising the sleep event, from the system
+// workqueue. The queue work can't run before that, so cut a running burst
+// short and send a short final burst from here, blocking for a bounded time.
+static int bthome_activity_state_listener(const zmk_event_t *eh)
+{
+    const struct zmk_activity_state_changed *ev = as_zmk_activity_state_changed(eh);
+    if (ev == NULL || ev->state != ZMK_ACTIVITY_SLEEP || bthome_adv == NULL)
+    {
+        return ZMK_EV_EVENT_BUBBLE;
+    }
+
+    const int64_t deadline = k_uptime_get() + CONFIG_ZMK_BTHOME_SLEEP_FLUSH_TIMEOUT_MS;
+    k_sem_reset(&bthome_adv_done_sem);
+
+    // A full burst takes seconds, don't wait it out
+    bool interrupted = false;
+    if (bthome_adv_active)
+    {
+        int rc = bt_le_ext_adv_stop(bthome_adv);
+        if (rc != 0)
+        {
+            LOG_WRN("Failed to stop BTHome advertisement before sleep: %d", rc);
+        }
+        bthome_adv_active = false;
+        interrupted = true;
+    }
+
+#if IS_ENABLED(CONFIG_ZMK_BTHOME_KEY_COUNT)
+    // Presses since the last interval report would be lost otherwise. The
+    // interval work stays scheduled in case the keyboard doesn't sleep after all.
+    bthome_key_count_report();
+#endif
+
+    if (k_msgq_num_used_get(&zmkbthome_button_msgq) > 0)
+    {
+        // Pending events merged with current sensor values. The stopped
+        // burst's buttons are not repeated, a new packet ID / counter would
+        // make receivers fire those button events a second time.
+        LOG_INF("Flushing BTHome events before sleep");
+        zmkbthome_send_queued(true);
+    }
+    else if (interrupted)
+    {
+        // Nothing new, finish the stopped advertisement with unchanged data
+        zmkbthome_adv_start(CONFIG_ZMK_BTHOME_SLEEP_FLUSH_PACKETS);
+    }
+
+    bthome_wait_adv_done(deadline);
+
+    return ZMK_EV_EVENT_BUBBLE;
+}
+ZMK_LISTENER(bthome_activity_state, bthome_activity_state_listener);
+ZMK_SUBSCRIPTION(bthome_activity_state, zmk_activity_state_changed);
+
+#endif // CONFIG_ZMK_BTHOME_SLEEP_FLUSH
+
 #if IS_ENABLED(CONFIG_ZMK_BTHOME_BATTERY_LEVEL)
 
 #if IS_ENABLED(CONFIG_ZMK_BTHOME_BATTERY_VOLTAGE) && !DT_HAS_CHOSEN(zmk_battery)
@@ -437,7 +744,7 @@ int update_bthome_battery_voltage()
 
     uint16_t mv = voltage.val1 * 1000 + (voltage.val2 / 1000);
 
-    bthome_payload.data.battery_voltage.data = sys_cpu_to_le16(mv);
+    BTHOME_VALUE(battery_voltage) = sys_cpu_to_le16(mv);
     return 0;
 }
 
@@ -468,8 +775,7 @@ int batt_state_changed_listener(const zmk_event_t *eh)
     LOG_DBG("BTHome battery state changed event: state_of_charge=%d", ev->state_of_charge);
 
     // set battery level to the payload
-    uint8_t battery_level = ev->state_of_charge;
-    bthome_payload.data.battery_level.data = battery_level;
+    BTHOME_VALUE(battery_level) = ev->state_of_charge;
 
 #if IS_ENABLED(CONFIG_ZMK_BTHOME_BATTERY_VOLTAGE) && DT_HAS_CHOSEN(zmk_battery)
     // Read voltage from sensor asynchronously (if enabled).
@@ -487,3 +793,86 @@ ZMK_LISTENER(battery_changed, batt_state_changed_listener);
 ZMK_SUBSCRIPTION(battery_changed, zmk_battery_state_changed);
 
 #endif // CONFIG_ZMK_BTHOME_BATTERY_LEVEL
+
+#if IS_ENABLED(CONFIG_ZMK_BTHOME_KEY_COUNT)
+
+// Counted per key press, reported and reset once per interval
+static atomic_t bthome_key_presses;
+#if (BTHOME_KEY_COUNT_LAYERS > 0)
+static atomic_t bthome_layer_key_presses[BTHOME_KEY_COUNT_LAYERS];
+#endif
+// whether the last report had any key presses, so a quiet interval
+// is reported once as zero and then stays off the air
+static bool bthome_key_count_reported;
+
+// Move the counts so far into the payload values and queue a report.
+// Returns false (and queues nothing) if there is nothing new to report.
+static bool bthome_key_count_report(void)
+{
+    uint16_t count = MIN(atomic_set(&bthome_key_presses, 0), UINT16_MAX);
+    BTHOME_VALUE(key_count) = sys_cpu_to_le16(count);
+#if (BTHOME_KEY_COUNT_LAYERS > 0)
+    for (int i = 0; i < BTHOME_KEY_COUNT_LAYERS; i++)
+    {
+        uint16_t layer_count = MIN(atomic_set(&bthome_layer_key_presses[i], 0), UINT16_MAX);
+        BTHOME_LAYER_KEY_COUNT(i) = sys_cpu_to_le16(layer_count);
+    }
+#endif
+
+    bool any = count > 0;
+    if (!any && !bthome_key_count_reported)
+    {
+        return false;
+    }
+    bthome_key_count_reported = any;
+
+    LOG_DBG("BTHome key count: %d", count);
+
+    // Counts ride along with the next advertisement like battery updates
+    zmk_bthome_queue_button_event(0, BTHOME_BTN_NONE);
+    return true;
+}
+
+static void bthome_key_count_work_handler(struct k_work *work)
+{
+    ARG_UNUSED(work);
+
+    k_work_schedule(&bthome_key_count_work, K_SECONDS(CONFIG_ZMK_BTHOME_KEY_COUNT_INTERVAL));
+    bthome_key_count_report();
+}
+
+#endif // CONFIG_ZMK_BTHOME_KEY_COUNT
+
+#if IS_ENABLED(CONFIG_ZMK_BTHOME_KEY_COUNT) || defined(ZMK_BTHOME_COEX_TRACK_TYPING)
+
+// Single key press listener for key counts and typing detection
+static int bthome_position_state_listener(const zmk_event_t *eh)
+{
+    const struct zmk_position_state_changed *ev = as_zmk_position_state_changed(eh);
+    if (ev == NULL || !ev->state)
+    {
+        return ZMK_EV_EVENT_BUBBLE;
+    }
+
+#if defined(ZMK_BTHOME_COEX_TRACK_TYPING)
+    zmk_bthome_coex_key_pressed();
+#endif
+
+#if IS_ENABLED(CONFIG_ZMK_BTHOME_KEY_COUNT)
+    atomic_inc(&bthome_key_presses);
+#endif
+
+#if (BTHOME_KEY_COUNT_LAYERS > 0)
+    uint8_t layer = zmk_keymap_highest_layer_active();
+    if (layer < BTHOME_KEY_COUNT_LAYERS)
+    {
+        atomic_inc(&bthome_layer_key_presses[layer]);
+    }
+#endif
+
+    return ZMK_EV_EVENT_BUBBLE;
+}
+ZMK_LISTENER(bthome_position_state, bthome_position_state_listener);
+ZMK_SUBSCRIPTION(bthome_position_state, zmk_position_state_changed);
+
+#endif // CONFIG_ZMK_BTHOME_KEY_COUNT || ZMK_BTHOME_COEX_TRACK_TYPING
@@ -0,0 +1,197 @@
+/*
+ * Copyright (c) 2026 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+/*
+ * Coexistence between BTHome advertising and the keyboard's own connections.
+ *
+ * BTHome bursts share the radio with the HID link. Battery-only updates
+ * can be held back while the user is typing, and optionally the advertising
+ * interval is set to a whole multiple of the fastest active connection
+ * interval instead of the default 100-150ms range.
+ */
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include <zephyr/bluetooth/bluetooth.h>
+#include <zephyr/bluetooth/conn.h>
+#include <zephyr/bluetooth/gap.h>
+#include <zephyr/kernel.h>
+#include <zephyr/sys/util.h>
+
+#include <zmk_bthome/zmk_bthome.h>
+
+#include <zephyr/logging/log.h>
+LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
+
+#if IS_ENABLED(CONFIG_ZMK_BTHOME_COEX_ALIGN_CONN_INTERVAL) || IS_ENABLED(CONFIG_ZMK_BTHOME_COEX_STATS)
+
+static void bthome_coex_find_conn_interval(struct bt_conn *conn, void *data)
+{
+    uint16_t *interval = data;
+    struct bt_conn_info info;
+
+    if (bt_conn_get_info(conn, &info) != 0 || info.state != BT_CONN_STATE_CONNECTED)
+    {
+        return;
+    }
+
+    if (*interval == 0 || info.le.interval < *interval)
+    {
+        *interval = info.le.interval;
+    }
+}
+
+// Connection interval (1.25ms units) of the fastest active LE link, 0 if none
+static uint16_t bthome_coex_conn_interval(void)
+{
+    uint16_t interval = 0;
+    bt_conn_foreach(BT_CONN_TYPE_LE, bthome_coex_find_conn_interval, &interval);
+    return interval;
+}
+
+#endif
+
+#if IS_ENABLED(CONFIG_ZMK_BTHOME_COEX_ALIGN_CONN_INTERVAL)
+
+void zmk_bthome_coex_adv_interval(uint32_t *interval_min, uint32_t *interval_max)
+{
+    *interval_min = BT_GAP_ADV_FAST_INT_MIN_2;
+    *interval_max = BT_GAP_ADV_FAST_INT_MAX_2;
+
+    uint16_t conn_interval = bthome_coex_conn_interval();
+    if (conn_interval == 0)
+    {
+        return;
+    }
+
+    // connection interval is in 1.25ms units, advertising interval in 0.625ms units
+    uint32_t step = (uint32_t)conn_interval * 2;
+    uint32_t aligned = DIV_ROUND_UP(BT_GAP_ADV_FAST_INT_MIN_2, step) * step;
+
+    // Slow links would stretch the burst past the advertising timeout,
+    // keep the default range for those.
+    if (aligned > BT_GAP_ADV_FAST_INT_MAX_2)
+    {
+        return;
+    }
+
+    // Fixed interval at a multiple of the connection interval. The
+    // controller still adds its random 0-10ms advDelay to every event.
+    *interval_min = aligned;
+    *interval_max = aligned;
+}
+
+#endif // CONFIG_ZMK_BTHOME_COEX_ALIGN_CONN_INTERVAL
+
+#if defined(ZMK_BTHOME_COEX_TRACK_TYPING)
+
+// uptime of the last key press, only meaningful when bthome_coex_typed is set
+static uint32_t bthome_coex_last_press;
+static bool bthome_coex_typed;
+
+#if IS_ENABLED(CONFIG_ZMK_BTHOME_COEX_STATS)
+static bool bthome_coex_burst_active;
+static uint32_t bthome_coex_burst_start;
+static uint16_t bthome_coex_burst_presses;
+#endif
+
+void zmk_bthome_coex_key_pressed(void)
+{
+    bthome_coex_last_press = k_uptime_get_32();
+    bthome_coex_typed = true;
+
+#if IS_ENABLED(CONFIG_ZMK_BTHOME_COEX_STATS)
+    if (bthome_coex_burst_active)
+    {
+        bthome_coex_burst_presses++;
+    }
+#endif
+}
+
+#endif // ZMK_BTHOME_COEX_TRACK_TYPING
+
+#if CONFIG_ZMK_BTHOME_COEX_TYPING_HOLDOFF_MS > 0
+
+// uptime when the current battery-only update was first held back, 0 if none
+static uint32_t bthome_coex_deferred_since;
+
+int32_t zmk_bthome_coex_typing_holdoff_ms(void)
+{
+    uint32_t now = k_uptime_get_32();
+
+    if (!bthome_coex_typed)
+    {
+        bthome_coex_deferred_since = 0;
+        return 0;
+    }
+
+    uint32_t idle = now - bthome_coex_last_press;
+    if (idle >= CONFIG_ZMK_BTHOME_COEX_TYPING_HOLDOFF_MS)
+    {
+        bthome_coex_deferred_since = 0;
+        return 0;
+    }
+
+    if (bthome_coex_deferred_since == 0)
+    {
+        // never store 0, it marks "not deferred"
+        bthome_coex_deferred_since = now ? now : 1;
+    }
+    else if (now - bthome_coex_deferred_since >= CONFIG_ZMK_BTHOME_COEX_TYPING_HOLDOFF_MAX_MS)
+    {
+        // Don't starve battery reports during a long typing session
+        LOG_DBG("BTHome typing holdoff expired, sending anyway");
+        bthome_coex_deferred_since = 0;
+        return 0;
+    }
+
+    return CONFIG_ZMK_BTHOME_COEX_TYPING_HOLDOFF_MS - idle;
+}
+
+#endif // CONFIG_ZMK_BTHOME_COEX_TYPING_HOLDOFF_MS > 0
+
+void zmk_bthome_coex_adv_started(uint32_t interval_min, uint32_t interval_max)
+{
+    ARG_UNUSED(interval_min);
+    ARG_UNUSED(interval_max);
+
+#if CONFIG_ZMK_BTHOME_COEX_TYPING_HOLDOFF_MS > 0
+    // Whatever was held back went out with this advertisement
+    bthome_coex_deferred_since = 0;
+#endif
+
+#if IS_ENABLED(CONFIG_ZMK_BTHOME_COEX_STATS)
+    bthome_coex_burst_start = k_uptime_get_32();
+    bthome_coex_burst_presses = 0;
+    bthome_coex_burst_active = true;
+
+    uint16_t conn_interval = bthome_coex_conn_interval();
+    LOG_INF("BTHome burst start: adv interval %u.%03u-%u.%03u ms, conn interval %u.%02u ms",
+            (interval_min * 625) / 1000, (interval_min * 625) % 1000,
+            (interval_max * 625) / 1000, (interval_max * 625) % 1000,
+            (conn_interval * 125) / 100, (conn_interval * 125) % 100);
+#endif
+}
+
+#if IS_ENABLED(CONFIG_ZMK_BTHOME_COEX_STATS)
+
+void zmk_bthome_coex_burst_sent(uint8_t num_sent)
+{
+    if (!bthome_coex_burst_active)
+    {
+        return;
+    }
+
+    bthome_coex_burst_active = false;
+
+    // Key presses that landed inside the burst are the ones whose HID
+    // reports could have been delayed by the advertising events.
+    LOG_INF("BTHome burst done: %u packets in %u ms, %u key presses during burst",
+            num_sent, k_uptime_get_32() - bthome_coex_burst_start, bthome_coex_burst_presses);
+}
+
+#endif // CONFIG_ZMK_BTHOME_COEX_STATS
@@ -6,7 +6,9 @@
 #include <zephyr/device.h>
 #include <zephyr/sys/byteorder.h>
 #include <zephyr/sys/util.h>
+#if IS_ENABLED(CONFIG_ZMK_BTHOME_CRYPTO_ZEPHYR)
 #include <zephyr/crypto/crypto.h>
+#endif
 #include <zephyr/logging/log.h>
 #include <string.h>
 
@@ -17,6 +19,8 @@ LOG_MODULE_DECLARE(zmk, CONFIG_ZMK_LOG_LEVEL);
 BUILD_ASSERT(sizeof(CONFIG_ZMK_BTHOME_ENCRYPTION_KEY) - 1 == 32,
              "CONFIG_ZMK_BTHOME_ENCRYPTION_KEY must be 32 hex characters (16 bytes)");
 
+#if IS_ENABLED(CONFIG_ZMK_BTHOME_CRYPTO_ZEPHYR)
+
 // TODO use only mbedtls shim?
 #ifdef CONFIG_CRYPTO_MBEDTLS_SHIM
 #define CRYPTO_DRV_NAME CONFIG_CRYPTO_MBEDTLS_SHIM_DRV_NAME
@@ -40,6 +44,8 @@ static inline const struct device *get_crypto_dev(void)
 
 static const struct device *crypto_dev = NULL;
 
+#endif // IS_ENABLED(CONFIG_ZMK_BTHOME_CRYPTO_ZEPHYR)
+
 static uint8_t bthome_key[16];
 static uint8_t nonce[13] = {
     0,
@@ -59,6 +65,7 @@ static uint8_t nonce[13] = {
 
 void zmk_bthome_encrypt_init(const uint8_t ble_addr[6])
 {
+#if IS_ENABLED(CONFIG_ZMK_BTHOME_CRYPTO_ZEPHYR)
     /* Resolve crypto device at runtime to avoid non-constant static init */
     if (crypto_dev == NULL)
     {
@@ -72,6 +79,7 @@ void zmk_bthome_encrypt_init(const uint8_t ble_addr[6])
     {
         LOG_WRN("Crypto device not ready: %s", crypto_dev->name);
     }
+#endif
 
     /* Nonce prefix: BLE address in reversed order per spec/example */
     nonce[0] = ble_addr[5];
@@ -96,8 +104,26 @@ void zmk_bthome_encrypt_init(const uint8_t ble_addr[6])
     }
 }
 
-int zmk_bthome_encrypt_payload(const uint8_t *plaintext, const size_t plaintext_len,
-                               const uint32_t replay_counter, uint8_t *enc_out,
+#if IS_ENABLED(CONFIG_ZMK_BTHOME_CRYPTO_BUILTIN)
+
+int zmk_bthome_encrypt_payload(uint8_t *data, const size_t data_len,
+                               const uint32_t replay_counter,
+                               uint8_t mic_out[BTHOME_ENCRYPT_TAG_LEN])
+{
+    /* copy counter into nonce (little endian) */
+    memcpy(&nonce[9], &replay_counter, 4);
+
+    uint32_t start = k_cycle_get_32();
+    int err = zmk_bthome_aes_ccm_encrypt(bthome_key, nonce, data, data_len, mic_out);
+    LOG_DBG("BTHome payload encrypted in %u cycles", k_cycle_get_32() - start);
+
+    return err;
+}
+
+#else // IS_ENABLED(CONFIG_ZMK_BTHOME_CRYPTO_BUILTIN)
+
+int zmk_bthome_encrypt_payload(uint8_t *data, const size_t data_len,
+                               const uint32_t replay_counter,
                                uint8_t mic_out[BTHOME_ENCRYPT_TAG_LEN])
 {
     if (!crypto_dev)
@@ -112,9 +138,16 @@ int zmk_bthome_encrypt_payload(const uint8_t *plaintext, const size_t plaintext_
         return -ENODEV;
     }
 
+    if (data_len > BTHOME_ENCRYPT_MAX_DATA_LEN)
+    {
+        return -EINVAL;
+    }
+
     /* copy counter into nonce (little endian) */
     memcpy(&nonce[9], &replay_counter, 4);
 
+    const bool inplace = (cipher_query_hwcaps(crypto_dev) & CAP_INPLACE_OPS) != 0;
+
     struct cipher_ctx context = {
         .keylen = sizeof(bthome_key),
         .key.bit_stream = bthome_key,
@@ -122,14 +155,23 @@ int zmk_bthome_encrypt_payload(const uint8_t *plaintext, const size_t plaintext_
             .nonce_len = sizeof(nonce),
             .tag_len = BTHOME_ENCRYPT_TAG_LEN,
         },
-        .flags = CAP_RAW_KEY | CAP_SYNC_OPS | CAP_SEPARATE_IO_BUFS,
+        .flags = CAP_RAW_KEY | CAP_SYNC_OPS | (inplace ? CAP_INPLACE_OPS : CAP_SEPARATE_IO_BUFS),
     };
 
+    /* Drivers without in-place support, including the default mbedTLS
+     * shim, read from a short-lived copy on the stack and write the
+     * ciphertext back over the plaintext. */
+    uint8_t plaintext[BTHOME_ENCRYPT_MAX_DATA_LEN];
+    if (!inplace)
+    {
+        memcpy(plaintext, data, data_len);
+    }
+
     struct cipher_pkt encrypt_pkt = {
-        .in_buf = (uint8_t *)plaintext,
-        .in_len = plaintext_len,
-        .out_buf_max = plaintext_len,
-        .out_buf = enc_out,
+        .in_buf = inplace ? data : plaintext,
+        .in_len = data_len,
+        .out_buf_max = data_len,
+        .out_buf = data,
     };
 
     struct cipher_aead_pkt ccm_op = {
@@ -139,6 +181,8 @@ int zmk_bthome_encrypt_payload(const uint8_t *plaintext, const size_t plaintext_
         .tag = mic_out,
     };
 
+    uint32_t start = k_cycle_get_32();
+
     int err = cipher_begin_session(crypto_dev, &context, CRYPTO_CIPHER_ALGO_AES,
                                    CRYPTO_CIPHER_MODE_CCM, CRYPTO_CIPHER_OP_ENCRYPT);
     if (err)
@@ -155,8 +199,11 @@ int zmk_bthome_encrypt_payload(const uint8_t *plaintext, const size_t plaintext_
         return err;
     }
 
-    /* Cipher wrote ciphertext into `enc_out` and tag into `mic_out`. */
+    /* Cipher wrote ciphertext over `data` and tag into `mic_out`. */
 
     cipher_free_session(crypto_dev, &context);
+    LOG_DBG("BTHome payload encrypted in %u cycles", k_cycle_get_32() - start);
     return 0;
 }
+
+#endif // IS_ENABLED(CONFIG_ZMK_BTHOME_CRYPTO_BUILTIN)
@@ -0,0 +1,22 @@
+/*
+ * Copyright (c) 2026 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+/*
+ * Built into the native simulator runner, not the Zephyr image, so it can
+ * use the host C library. Simulated time stands still while code runs on
+ * native_sim, so the benchmark needs the host's clock instead.
+ */
+
+#include <stdint.h>
+#include <time.h>
+
+uint64_t bthome_test_host_time_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
@@ -0,0 +1,227 @@
+/*
+ * Copyright (c) 2026 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/util.h>
+#include <zephyr/ztest.h>
+
+#include <mbedtls/ccm.h>
+
+#include <zmk_bthome/zmk_bthome.h>
+
+#define MAX_DATA_LEN 32
+#define BENCH_ROUNDS 1000
+
+#if IS_ENABLED(CONFIG_NATIVE_LIBRARY)
+// Simulated time doesn't advance while code runs, time with the host clock
+uint64_t bthome_test_host_time_ns(void);
+
+static inline uint64_t bench_now(void)
+{
+    return bthome_test_host_time_ns();
+}
+
+static inline uint64_t bench_elapsed_ns(const uint64_t start)
+{
+    return bthome_test_host_time_ns() - start;
+}
+#else
+static inline uint64_t bench_now(void)
+{
+    return k_cycle_get_32();
+}
+
+static inline uint64_t bench_elapsed_ns(const uint64_t start)
+{
+    return k_cyc_to_ns_floor64((uint32_t)(k_cycle_get_32() - (uint32_t)start));
+}
+#endif
+
+struct ccm_vector
+{
+    const char *name;
+    uint8_t key[16];
+    uint8_t nonce[13];
+    uint8_t plaintext[MAX_DATA_LEN];
+    uint8_t ciphertext[MAX_DATA_LEN];
+    size_t len;
+    uint8_t tag[BTHOME_ENCRYPT_TAG_LEN];
+};
+
+// Expected values generated with an independent AES-CCM implementation
+static const struct ccm_vector vectors[] = {
+    {
+        // https://bthome.io/encryption/ example: temperature and humidity,
+        // MAC 54:48:E6:8F:80:A5, device info 0x41, counter 0x33221100
+        .name = "bthome spec example",
+        .key = {0x23, 0x1d, 0x39, 0xc1, 0xd7, 0xcc, 0x1a, 0xb1,
+                0xae, 0xe2, 0x24, 0xcd, 0x09, 0x6d, 0xb9, 0x32},
+        .nonce = {0x54, 0x48, 0xe6, 0x8f, 0x80, 0xa5, 0xd2, 0xfc,
+                  0x41, 0x00, 0x11, 0x22, 0x33},
+        .plaintext = {0x02, 0xca, 0x09, 0x03, 0xbf, 0x13},
+        .ciphertext = {0xa4, 0x72, 0x66, 0xc9, 0x5f, 0x73},
+        .len = 6,
+        .tag = {0x78, 0x23, 0x72, 0x14},
+    },
+    {
+        .name = "empty",
+        .key = {0x44, 0x20, 0x82, 0x3c, 0xfd, 0xe6, 0xf1, 0xc2,
+                0x6b, 0x30, 0xf9, 0x0e, 0xc7, 0xdd, 0x01, 0xe4},
+        .nonce = {0x88, 0x75, 0x34, 0xa2, 0x0f, 0x0b, 0x0d, 0x04,
+                  0xc3, 0x6e, 0xd8, 0x0e, 0x71},
+        .len = 0,
+        .tag = {0xa7, 0x87, 0x4b, 0x47},
+    },
+    {
+        .name = "1 byte",
+        .key = {0xe0, 0xfd, 0x77, 0xb0, 0x76, 0x70, 0xeb, 0x94,
+                0x0b, 0xd5, 0x33, 0x5f, 0x97, 0x3d, 0xaa, 0xd8},
+        .nonce = {0x61, 0x9b, 0x91, 0xff, 0xc9, 0x11, 0xf5, 0x7c,
+                  0xce, 0xd4, 0x58, 0xbb, 0xbf},
+        .plaintext = {0x2c},
+        .ciphertext = {0xc2},
+        .len = 1,
+        .tag = {0x0e, 0x35, 0x6f, 0x6d},
+    },
+    {
+        // largest object payload that fits an encrypted advertisement
+        .name = "15 bytes",
+        .key = {0xe0, 0x37, 0x53, 0xc9, 0xbd, 0xfa, 0x0f, 0xf0,
+                0x16, 0x9d, 0xc9, 0x57, 0x56, 0x74, 0x06, 0x66},
+        .nonce = {0x76, 0xcf, 0xb0, 0xb4, 0xeb, 0x89, 0x02, 0xc4,
+                  0x42, 0x69, 0xda, 0x1c, 0xf6},
+        .plaintext = {0xba, 0x66, 0xd3, 0xf8, 0xb6, 0xd4, 0xb1, 0x00,
+                      0xa9, 0xea, 0x0e, 0x75, 0x5a, 0x5c, 0x2e},
+        .ciphertext = {0xf4, 0x93, 0x8a, 0xa2, 0x51, 0x56, 0x58, 0xb9,
+                       0xc1, 0xe1, 0x6c, 0xc6, 0x37, 0x0a, 0x02},
+        .len = 15,
+        .tag = {0xdc, 0x4b, 0xfa, 0xfa},
+    },
+    {
+        .name = "16 bytes",
+        .key = {0x82, 0x10, 0x24, 0x2a, 0x08, 0xe7, 0x07, 0x8f,
+                0x7f, 0x89, 0x38, 0x5e, 0xb0, 0x94, 0x23, 0x55},
+        .nonce = {0x51, 0x82, 0x56, 0x8b, 0x96, 0xe8, 0xa4, 0xfe,
+                  0xf2, 0x3a, 0x0c, 0x9f, 0xc5},
+        .plaintext = {0xaf, 0xd7, 0x60, 0x84, 0x37, 0x81, 0x6b, 0xdd,
+                      0x0a, 0x73, 0x09, 0xcb, 0x4a, 0x12, 0x52, 0xe4},
+        .ciphertext = {0x79, 0x74, 0xf8, 0x4a, 0xb4, 0xc4, 0xfd, 0x22,
+                       0xc5, 0xc2, 0x41, 0x07, 0x3f, 0x72, 0x69, 0xd2},
+        .len = 16,
+        .tag = {0x7a, 0xe8, 0xa6, 0x7d},
+    },
+    {
+        .name = "17 bytes",
+        .key = {0xda, 0x70, 0xe6, 0x72, 0x0f, 0xca, 0xa4, 0xda,
+                0x1e, 0x98, 0x40, 0x6c, 0x18, 0x9c, 0x24, 0x27},
+        .nonce = {0x9e, 0x98, 0x51, 0xd5, 0x81, 0x42, 0x04, 0x13,
+                  0x6f, 0xeb, 0x57, 0x13, 0xc1},
+        .plaintext = {0x66, 0xb1, 0x32, 0x69, 0xdd, 0x63, 0xfc, 0x35,
+                      0xc7, 0x97, 0xff, 0x08, 0xa6, 0xcd, 0x90, 0x09,
+                      0x50},
+        .ciphertext = {0x5c, 0xdd, 0x2a, 0x6f, 0xf1, 0xb5, 0x3c, 0x21,
+                       0x82, 0x17, 0x59, 0x9f, 0xc6, 0x26, 0xc4, 0x8f,
+                       0x3c},
+        .len = 17,
+        .tag = {0xda, 0x19, 0xd2, 0x98},
+    },
+    {
+        .name = "23 bytes",
+        .key = {0x66, 0xa7, 0x45, 0xad, 0xdb, 0x6d, 0x88, 0x31,
+                0xc2, 0xb0, 0xf8, 0x78, 0x21, 0x14, 0x2b, 0x44},
+        .nonce = {0x56, 0x55, 0x6d, 0x89, 0xaa, 0x82, 0xbc, 0xad,
+                  0xae, 0x3a, 0x95, 0x78, 0xfa},
+        .plaintext = {0x45, 0x35, 0xa4, 0x14, 0xd0, 0x25, 0xc2, 0x4b,
+                      0x40, 0xae, 0x3a, 0xc1, 0x27, 0x72, 0x29, 0x88,
+                      0xba, 0x97, 0x3a, 0xea, 0x8d, 0x37, 0x17},
+        .ciphertext = {0x97, 0xe1, 0x74, 0x86, 0x5f, 0xea, 0x68, 0xe8,
+                       0x37, 0x9a, 0xca, 0xc8, 0xc2, 0x3d, 0xfa, 0x93,
+                       0x4d, 0xf1, 0x95, 0x71, 0x08, 0xe8, 0xd6},
+        .len = 23,
+        .tag = {0xd1, 0xf2, 0x5f, 0x13},
+    },
+};
+
+static int mbedtls_ccm_encrypt(const struct ccm_vector *v, uint8_t *out, uint8_t *tag)
+{
+    mbedtls_ccm_context ctx;
+    mbedtls_ccm_init(&ctx);
+
+    int rc = mbedtls_ccm_setkey(&ctx, MBEDTLS_CIPHER_ID_AES, v->key, 128);
+    if (rc == 0)
+    {
+        rc = mbedtls_ccm_encrypt_and_tag(&ctx, v->len, v->nonce, sizeof(v->nonce), NULL, 0,
+                                         v->plaintext, out, tag, BTHOME_ENCRYPT_TAG_LEN);
+    }
+
+    mbedtls_ccm_free(&ctx);
+    return rc;
+}
+
+ZTEST_SUITE(bthome_aes_ccm, NULL, NULL, NULL, NULL, NULL);
+
+ZTEST(bthome_aes_ccm, test_known_answer)
+{
+    for (size_t i = 0; i < ARRAY_SIZE(vectors); i++)
+    {
+        const struct ccm_vector *v = &vectors[i];
+        uint8_t data[MAX_DATA_LEN];
+        uint8_t tag[BTHOME_ENCRYPT_TAG_LEN];
+
+        memcpy(data, v->plaintext, v->len);
+        zassert_ok(zmk_bthome_aes_ccm_encrypt(v->key, v->nonce, data, v->len, tag), "%s", v->name);
+        zassert_mem_equal(data, v->ciphertext, v->len, "%s: ciphertext mismatch", v->name);
+        zassert_mem_equal(tag, v->tag, sizeof(tag), "%s: tag mismatch", v->name);
+    }
+}
+
+ZTEST(bthome_aes_ccm, test_matches_mbedtls)
+{
+    for (size_t i = 0; i < ARRAY_SIZE(vectors); i++)
+    {
+        const struct ccm_vector *v = &vectors[i];
+        uint8_t data[MAX_DATA_LEN], ref[MAX_DATA_LEN];
+        uint8_t tag[BTHOME_ENCRYPT_TAG_LEN], ref_tag[BTHOME_ENCRYPT_TAG_LEN];
+
+        memcpy(data, v->plaintext, v->len);
+        zassert_ok(zmk_bthome_aes_ccm_encrypt(v->key, v->nonce, data, v->len, tag));
+        zassert_ok(mbedtls_ccm_encrypt(v, ref, ref_tag), "%s", v->name);
+        zassert_mem_equal(data, ref, v->len, "%s: differs from mbedTLS", v->name);
+        zassert_mem_equal(tag, ref_tag, sizeof(tag), "%s: tag differs from mbedTLS", v->name);
+    }
+}
+
+// Prints the time per packet for both implementations. On native_sim this
+// is host CPU time, only the ratio between the two is meaningful.
+ZTEST(bthome_aes_ccm, test_benchmark)
+{
+    const struct ccm_vector *v = &vectors[3]; // 15 bytes, worst case packet
+    uint8_t data[MAX_DATA_LEN];
+    uint8_t tag[BTHOME_ENCRYPT_TAG_LEN];
+
+    uint64_t start = bench_now();
+    for (int i = 0; i < BENCH_ROUNDS; i++)
+    {
+        memcpy(data, v->plaintext, v->len);
+        zmk_bthome_aes_ccm_encrypt(v->key, v->nonce, data, v->len, tag);
+    }
+    uint64_t builtin_ns = bench_elapsed_ns(start);
+
+    start = bench_now();
+    for (int i = 0; i < BENCH_ROUNDS; i++)
+    {
+        // includes key setup, as the Zephyr crypto backend does per packet
+        mbedtls_ccm_encrypt(v, data, tag);
+    }
+    uint64_t mbedtls_ns = bench_elapsed_ns(start);
+
+    zassert_true(builtin_ns > 0 && mbedtls_ns > 0, "benchmark clock did not advance");
+
+    TC_PRINT("ns per %u byte packet: builtin %u, mbedtls %u\n", (unsigned int)v->len,
+             (uint32_t)(builtin_ns / BENCH_ROUNDS), (uint32_t)(mbedtls_ns / BENCH_ROUNDS));
+}
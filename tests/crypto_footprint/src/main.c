@@ -0,0 +1,30 @@
+/*
+ * Copyright (c) 2026 The ZMK Contributors
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+/*
+ * Smallest user of zmk_bthome_encrypt_payload(), built once per crypto
+ * backend to compare their flash and RAM cost.
+ */
+
+#include <stdint.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/printk.h>
+
+#include <zmk_bthome/zmk_bthome.h>
+
+int main(void)
+{
+    static const uint8_t addr[6] = {0xa5, 0x80, 0x8f, 0xe6, 0x48, 0x54};
+    uint8_t data[BTHOME_ENCRYPT_MAX_DATA_LEN] = {0x02, 0xca, 0x09, 0x03, 0xbf, 0x13};
+    uint8_t mic[BTHOME_ENCRYPT_TAG_LEN];
+
+    zmk_bthome_encrypt_init(addr);
+    int rc = zmk_bthome_encrypt_payload(data, 6, 0x33221100, mic);
+
+    printk("encrypt rc %d, mic %02x%02x%02x%02x\n", rc, mic[0], mic[1], mic[2], mic[3]);
+    return 0;
+}